@@ -28,6 +28,56 @@
 
 #include "Moka.h"
 
+//MokaStats class: timing histogram.
+
+// Create the histogram. /width/ is the bucket width, in whatever unit values are given (micros for latency).
+MokaStats::MokaStats(uint16_t width){
+	_width = (width > 0) ? width : 1;
+	reset();
+}
+
+// Add a value to the histogram.
+void MokaStats::add(uint32_t value){
+	uint32_t bucket = value / _width;
+	if(bucket > 31) bucket = 31;
+	if(_bucket[bucket] < 0xFFFF) ++_bucket[bucket];
+
+	if(_count == 0 || value < _min) _min = value;
+	if(value > _max) _max = value;
+	if(_count < 0xFFFF) ++_count;
+}
+
+// Clear all values.
+void MokaStats::reset(){
+	for(uint8_t i = 0; i < 32; i++){
+		_bucket[i] = 0;
+	}
+	_count = 0;
+	_min = 0;
+	_max = 0;
+}
+
+// Get the value under which /percent/ % of the values are.
+// This is the upper bound of the bucket holding the percentile, never more than the max value seen.
+uint32_t MokaStats::percentile(uint8_t percent) const{
+	if(_count == 0) return 0;
+	if(percent > 100) percent = 100;
+
+	uint32_t target = ((uint32_t)_count * percent + 99) / 100;
+	if(target == 0) target = 1;
+
+	uint32_t sum = 0;
+	for(uint8_t i = 0; i < 31; i++){
+		sum += _bucket[i];
+		if(sum >= target){
+			uint32_t bound = (uint32_t)(i + 1) * _width;
+			return (bound < _max) ? bound : _max;
+		}
+	}
+
+	return _max;
+}
+
 //Moka class: managing one Moka tile.
 
 // Set the new tile: create its address and the I2C bus speed.
@@ -50,6 +100,16 @@ void Moka::begin(uint8_t address, bool fast){
 	Wire.endTransmission();
 
 	_update = 0;
+	_updateState = false;
+	_reactive = REACTIVE_OFF;
+	_stats = NULL;
+	_pressTime = NULL;
+	_pressPending = 0;
+	_maxAge = 0;
+	_lastRead = 0;
+	_queried = 0;
+	_overlay = 0;
+	_nextOverlay = 0;
 }
 
 // Set the new tile with a bus speed of 400000Hz
@@ -57,6 +117,24 @@ void Moka::beginFast(uint8_t address){
 	begin(address, true);
 }
 
+// Attach the tile to an address without any bus traffic.
+// This is used when the bus and the tiles are set up elsewhere, e.g. by Mokas::beginScan(),
+// that configures every tile at once with broadcast writes.
+void Moka::attach(uint8_t address){
+	_i2cAddress = address;
+	_update = 0;
+	_updateState = false;
+	_reactive = REACTIVE_OFF;
+	_stats = NULL;
+	_pressTime = NULL;
+	_pressPending = 0;
+	_maxAge = 0;
+	_lastRead = 0;
+	_queried = 0;
+	_overlay = 0;
+	_nextOverlay = 0;
+}
+
 // LED settings: All this methods apply both to class tables and to Moka tile.
 // You will have to call update() for these settings to take effect.
 
@@ -161,6 +239,38 @@ void Moka::setGlobalColor(uint8_t color){
 	_update = 0xFF;	
 }
 
+// Apply the same change to all leds set in /mask/, bit n being led n. See LED_OP for operations.
+// This is the same as calling setLed(), clrLed(), setColor() or setBrightness() on each led,
+// with state and update done on the whole mask at once. A state change sends only the led state.
+void Moka::setLedMask(uint16_t mask, uint8_t op, uint8_t value){
+	if(mask == 0) return;
+
+	// State changes only need the led state to be sent, not colors.
+	if(op == OP_STATE){
+		if(value){
+			_ledState |= mask;
+		} else {
+			_ledState &= ~mask;
+		}
+		_updateState = true;
+		return;
+	} else {
+		if(op == OP_BRIGHTNESS && value > 3) return;
+		for(uint8_t i = 0; i < 16; i++){
+			if(!(mask & _BV(i))) continue;
+			if(op == OP_COLOR){
+				_led[i] = value;
+			} else if(op == OP_RGB){
+				_led[i] = (_led[i] & 0xC0) | (value & 0x3F);
+			} else if(op == OP_BRIGHTNESS){
+				_led[i] = (_led[i] & 0x3F) | (value << 6);
+			}
+		}
+	}
+
+	_update |= mask;
+}
+
 // Update the leds, i.e. send the new led values to the display.
 // This must be called every time you want to update led values on board.
 // First send the led state (lit or shut)
@@ -168,7 +278,7 @@ void Moka::setGlobalColor(uint8_t color){
 // This way communication is reduced to the minimum.
 void Moka::updateLeds(){
 //	Serial.println(_update, BIN);
-	if(_update == 0) return;
+	if(_update == 0 && !_updateState) return;
 
 	uint8_t ok = 0;
 
@@ -196,19 +306,19 @@ void Moka::updateLeds(){
 		Wire.beginTransmission(_i2cAddress);
 		Wire.write(SET_ALL_LED);
 		for(uint8_t i = 0; i < 16; i++){
-			Wire.write(_led[i]);
+			Wire.write(ledColor(i));
 		}
 		ok = Wire.endTransmission();
 //		Serial.print("all leds \t");
 //		Serial.println(ok);
 
-	} else {
+	} else if(qty > 0){
 		// Here we update leds one after another, each one with a new command.
-		Wire.beginTransmission(_i2cAddress);
 		for(uint8_t i = 0; i < 16; i++){
 			if(_update & _BV(i)){
+				Wire.beginTransmission(_i2cAddress);
 				Wire.write(SET_ONE_LED | i);
-				Wire.write(_led[i]);
+				Wire.write(ledColor(i));
 				ok = Wire.endTransmission(false);
 //				Serial.print("led ");
 //				Serial.print(i);
@@ -217,20 +327,20 @@ void Moka::updateLeds(){
 
 			}
 		}
-		Wire.endTransmission();
 	}
 
 	// update the led states.
 	Wire.beginTransmission(_i2cAddress);
 	Wire.write(LED_STATE);
-	Wire.write((_ledState >> 8));
-	Wire.write(_ledState & 0xFF);
+	Wire.write((ledState() >> 8));
+	Wire.write(ledState() & 0xFF);
 	Wire.endTransmission(false);
 
 
 //	Serial.println();
 
 	_update = 0;
+	_updateState = false;
 
 }
 
@@ -241,6 +351,88 @@ void Moka::updateDisplay() const{
 	Wire.beginTransmission(_i2cAddress);
 	Wire.write(UPDATE_DISPLAY);
 	Wire.endTransmission();
+
+	stamp();
+}
+
+
+// Overlay: a set of leds shown with one color over the normal led state, without changing it.
+// This is used by the playhead of Mokas. The overlay is staged first, so the next commit only does bus writes.
+void Moka::stageOverlay(uint16_t mask){
+	_nextOverlay = mask;
+}
+
+// Show the staged overlay: only leds entering or leaving the overlay are sent, followed by the led state.
+// Returns false if nothing had to be sent.
+bool Moka::commitOverlay(){
+	uint16_t out = _overlay & ~_nextOverlay;
+	uint16_t in = _nextOverlay & ~_overlay;
+	if((out | in) == 0) return false;
+
+	_overlay = _nextOverlay;
+
+	for(uint8_t i = 0; i < 16; i++){
+		if(!((out | in) & _BV(i))) continue;
+		// The tile only shows _led[i] if it has been sent already.
+		if(!(_update & _BV(i)) && (_led[i] == _overlayColor)) continue;
+		Wire.beginTransmission(_i2cAddress);
+		Wire.write(SET_ONE_LED | i);
+		Wire.write(ledColor(i));
+		Wire.endTransmission(false);
+	}
+
+	Wire.beginTransmission(_i2cAddress);
+	Wire.write(LED_STATE);
+	Wire.write((ledState() >> 8));
+	Wire.write(ledState() & 0xFF);
+	Wire.endTransmission();
+
+	return true;
+}
+
+// Scenes: a scene is a snapshot of the whole tile, stored in SCENE_SIZE bytes:
+// led state on two bytes (MSB first), then the 16 led colors.
+// It can be saved in RAM, or declared in PROGMEM to be recalled with recallScene_P().
+
+// Save the current tile state to /scene/, that must be SCENE_SIZE bytes long.
+void Moka::saveScene(uint8_t *scene) const{
+	scene[0] = _ledState >> 8;
+	scene[1] = _ledState & 0xFF;
+	for(uint8_t i = 0; i < 16; i++){
+		scene[i + 2] = _led[i];
+	}
+}
+
+// Recall a scene from RAM.
+// Only what differs from the current state is marked for update, so the next updateLeds()
+// sends the minimum: changed colors, and the led state alone if only it has changed.
+void Moka::recallScene(const uint8_t *scene){
+	applyScene(scene);
+}
+
+// Same for a scene stored in PROGMEM.
+void Moka::recallScene_P(const uint8_t *scene){
+	uint8_t buffer[SCENE_SIZE];
+	for(uint8_t i = 0; i < SCENE_SIZE; i++){
+		buffer[i] = pgm_read_byte(scene + i);
+	}
+	applyScene(buffer);
+}
+
+// Diff the scene against the current state.
+void Moka::applyScene(const uint8_t *scene){
+	uint16_t state = ((uint16_t)scene[0] << 8) | scene[1];
+	if(state != _ledState){
+		_ledState = state;
+		_updateState = true;
+	}
+
+	for(uint8_t i = 0; i < 16; i++){
+		if(_led[i] != scene[i + 2]){
+			_led[i] = scene[i + 2];
+			_update |= _BV(i);
+		}
+	}
 }
 
 
@@ -252,6 +444,9 @@ void Moka::updateDisplay() const{
 // Get a read of the buttons from the panel.
 // This method returns true when the nis a change, so you can use it as a conditionnal test.
 bool Moka::readButtons(){
+	uint32_t now = micros();
+	uint16_t last;
+
 	Wire.beginTransmission(_i2cAddress);
 	Wire.write(GET_BUTTONS);
 	uint8_t ok = Wire.endTransmission();
@@ -263,7 +458,7 @@ bool Moka::readButtons(){
 	if(ok == 2){
 //		Serial.print("bytes returned: ");
 //		Serial.println(ok);
-		_prevButtons = _buttons;
+		last = _buttons;
 		_buttons = ((uint16_t)Wire.read() << 8);
 		_buttons |= Wire.read();
 //		Serial.print("buttons:\t");
@@ -274,58 +469,204 @@ bool Moka::readButtons(){
 		return false;
 	}
 
-	if(_prevButtons != _buttons){
-		return true;
-	} else {
-		return false;
+	// With lazy reads, edges that the sketch has not asked for yet are kept,
+	// as long as the button is still in the same state.
+	uint16_t keep = 0;
+	if(_maxAge){
+		keep = (last ^ _prevButtons) & ~_queried;
+		_lastRead = millis();
+		_queried = 0;
+	}
+	_prevButtons = (last & ~keep) | (_prevButtons & keep);
+
+	if(last == _buttons) return false;
+
+	uint16_t pressed = _buttons & ~last;
+	uint16_t released = last & ~_buttons;
+
+	// Keep track of the presses waiting for their led to light, each one with its own time.
+	if(_stats){
+		_pressPending &= ~released;
+		_pressPending |= pressed;
+		for(uint8_t i = 0; i < 16; i++){
+			if(pressed & _BV(i)) _pressTime[i] = now;
+		}
+	}
+
+	if(_reactive != REACTIVE_OFF){
+		react(pressed, released);
+	}
+
+	return true;
+}
+
+// Set the reactive mode: in this mode the tile gives feedback as soon as a press is read,
+// by sending the changed leds followed by an update display to this tile only,
+// ahead of the next updateLeds() and updateDisplay().
+// See REACTIVE_MODE for available modes. Sketch can still change the leds as usual.
+void Moka::setReactive(uint8_t mode){
+	_reactive = mode;
+}
+
+// Attach a MokaStats object to record press to light latency, in microseconds.
+// Latency runs from the button read that sees a press to the display update that lits its led.
+// Press times take 64 more bytes of RAM per tile, only while recording. Pass NULL to stop recording.
+void Moka::setStats(MokaStats *stats){
+	_pressPending = 0;
+	if(stats && !_pressTime){
+		_pressTime = new uint32_t[16];
+	} else if(!stats){
+		delete[] _pressTime;
+		_pressTime = NULL;
+	}
+
+	_stats = _pressTime ? stats : NULL;
+}
+
+// Fast local feedback path: update the led state for pressed or released buttons,
+// then send only what is needed to show it on this tile.
+void Moka::react(uint16_t pressed, uint16_t released){
+	uint16_t changed = 0;
+	if(_reactive == REACTIVE_MOMENTARY){
+		_ledState |= pressed;
+		_ledState &= ~released;
+		changed = pressed | released;
+	} else if(_reactive == REACTIVE_TOGGLE){
+		_ledState ^= pressed;
+		changed = pressed;
 	}
+
+	if(changed == 0) return;
+
+	// Colors are only sent for the leds that have one waiting.
+	for(uint8_t i = 0; i < 16; i++){
+		if(changed & _update & _BV(i)){
+			Wire.beginTransmission(_i2cAddress);
+			Wire.write(SET_ONE_LED | i);
+			Wire.write(ledColor(i));
+			Wire.endTransmission(false);
+		}
+	}
+
+	Wire.beginTransmission(_i2cAddress);
+	Wire.write(LED_STATE);
+	Wire.write((ledState() >> 8));
+	Wire.write(ledState() & 0xFF);
+	Wire.endTransmission(false);
+
+	Wire.beginTransmission(_i2cAddress);
+	Wire.write(UPDATE_DISPLAY);
+	Wire.endTransmission();
+
+	_update &= ~changed;
+	_updateState = false;
+
+	stamp();
+}
+
+// Record latency for each pending press which led is now displayed.
+// Presses displayed with their led shut have been handled without lighting it (e.g. toggled off),
+// so they are dropped rather than timed.
+void Moka::stamp() const{
+	if(!_stats || _pressPending == 0) return;
+
+	uint16_t shown = _pressPending & ~_update;
+	uint16_t lit = shown & _ledState;
+	uint32_t now = micros();
+	for(uint8_t i = 0; i < 16; i++){
+		if(lit & _BV(i)) _stats->add(now - _pressTime[i]);
+	}
+
+	_pressPending &= ~shown;
+}
+
+// Set the max age of button values, in milliseconds, for lazy reads.
+// When set, isPressed(), wasPressed(), isJustPressed() and isJustReleased() read the buttons of the tile
+// only if the last read is older than /age/, so there is no need to call readButtons() on each loop.
+// This is why these methods are not const. 0 (default) disables lazy reads.
+void Moka::setMaxAge(uint16_t age){
+	_maxAge = age;
+	_queried = 0;
+	_lastRead = millis() - age;
+}
+
+// Read the buttons if lazy reads are enabled and the last read is too old.
+void Moka::refresh(){
+	if(_maxAge == 0) return;
+	if((millis() - _lastRead) < _maxAge) return;
+
+	// Set before reading, so a tile that doesn't answer isn't asked again on every query.
+	_lastRead = millis();
+	readButtons();
+}
+
+// With lazy reads, an edge is reported only once: the next queries within max age won't see it again.
+// Without, edges stay until the next readButtons(), as the sketch reads them once per loop.
+void Moka::consume(uint8_t index){
+	if(_maxAge == 0) return;
+
+	_prevButtons &= ~_BV(index);
+	_prevButtons |= (_buttons & _BV(index));
 }
 
 // Return true if the given button is being pressed.
-bool Moka::isPressed(uint8_t index) const{
+bool Moka::isPressed(uint8_t index){
 	if(index > 15) return false;
 
+	refresh();
 	return (_buttons & _BV(index));
 }
 
 // Same for led addressed by col and row.
-bool Moka::isPressed(uint8_t col, uint8_t row) const{
+bool Moka::isPressed(uint8_t col, uint8_t row){
 	return isPressed(posToIndex(col, row));
 }
 
 // Return true if the button was pressed on last reading, but is not
-bool Moka::wasPressed(uint8_t index) const{
+bool Moka::wasPressed(uint8_t index){
 	if(index > 15) return false;
 
+	refresh();
+	_queried |= _BV(index);
 	return (_prevButtons & _BV(index));
 }
 
 // Same for led addressed by col and row.
-bool Moka::wasPressed(uint8_t col, uint8_t row) const{
+bool Moka::wasPressed(uint8_t col, uint8_t row){
 	return wasPressed(posToIndex(col, row));
 }
 
 // Return true if the button has been newly pressed.
-bool Moka::isJustPressed(uint8_t index) const{
+bool Moka::isJustPressed(uint8_t index){
 	if(index > 15) return false;
 
-	return (isPressed(index) && !wasPressed(index));
+	refresh();
+	_queried |= _BV(index);
+	if(!(_buttons & ~_prevButtons & _BV(index))) return false;
+
+	consume(index);
+	return true;
 }
 
 // Same for led addressed by col and row.
-bool Moka::isJustPressed(uint8_t col, uint8_t row) const{
+bool Moka::isJustPressed(uint8_t col, uint8_t row){
 	return isJustPressed(posToIndex(col, row));
 }
 
 // Return true if the button has been newly released.
-bool Moka::isJustReleased(uint8_t index) const{
+bool Moka::isJustReleased(uint8_t index){
 	if(index > 15) return false;
 
-	return (!isPressed(index) && wasPressed(index));
+	refresh();
+	_queried |= _BV(index);
+	if(!(~_buttons & _prevButtons & _BV(index))) return false;
+
+	consume(index);
+	return true;
 }
 
 // Same for led addressed by col and row.
-bool Moka::isJustReleased(uint8_t col, uint8_t row) const{
+bool Moka::isJustReleased(uint8_t col, uint8_t row){
 	return isJustReleased(posToIndex(col, row));
 }
 
@@ -387,8 +728,21 @@ void Moka::reset() const{
 /////////////////////////////////////////////////
 
 
+Mokas::Mokas(){
+	_map = NULL;
+	_nbBoards = 0;
+	_playing = false;
+	_playStats = NULL;
+}
+
 // Create a big board out of several tiles. Cols and rows
 bool Mokas::begin(uint8_t cols, uint8_t rows){
+	delete[] _map;
+	_map = NULL;
+	for(uint8_t i = 0; i < 32; i++){
+		_orientation[i] = ROTATE_0;
+	}
+
 	_nbCol = cols;
 	_nbRow = rows;
 	if(rows == 0) return true;
@@ -406,10 +760,15 @@ bool Mokas::begin(uint8_t cols, uint8_t rows){
 // Will return false until we have reach the number of board defined with begin()
 // When using this method you can use any address you want for any board you want,
 // But you still have to declare boards from left to right and up to down.
-bool Mokas::add(Moka *board){
+// /orientation/ tells how the tile is mounted, see ORIENTATION.
+// Once the last tile is added, the index lookup table is built. It takes 32 bytes of RAM per tile,
+// i.e. 1KB for 32 tiles. Returns true too if there is not enough memory for it.
+bool Mokas::add(Moka *board, uint8_t orientation){
 	if(_addBoard >= _nbBoards) return true;
 	_boards[_addBoard] = board;
+	_orientation[_addBoard] = orientation;
 	++_addBoard;
+	if(_addBoard == _nbBoards) return buildMap();
 	return false;
 }
 
@@ -426,8 +785,350 @@ bool Mokas::beginAuto(uint8_t cols, uint8_t rows, bool fast){
 		board->begin(address + i, fast);
 	}
 
+	return buildMap();
+}
+
+// Same as beginAuto(), but the bus is scanned first, so only tiles that actually answer are used.
+// Tiles are attached in crescent address order, then all of them are set up at once,
+// using broadcast address 0 for display on and color mode.
+// Returns true if the number of tiles found doesn't match cols * rows.
+// In that case, getPresent() tells which addresses answered, so mis-jumpered tiles can be spotted.
+bool Mokas::beginScan(uint8_t cols, uint8_t rows, bool fast){
+	bool status = begin(cols, rows);
+	if(status) return status;
+
+	Wire.begin();
+	if(fast){
+		Wire.setClock(200000L);
+	}
+
+	if(scan() != _nbBoards) return true;
+
+	uint8_t board = 0;
+	for(uint8_t i = 0; i < 32; i++){
+		if(!(_present & ((uint32_t)1 << i))) continue;
+		Moka *tile = new Moka();
+		tile->attach(10 + i);
+		_boards[board++] = tile;
+	}
+
+	Wire.beginTransmission(0);
+	Wire.write(Moka::DISPLAY_STATE | 1);
+	Wire.endTransmission(false);
+	Wire.beginTransmission(0);
+	Wire.write(Moka::COLOR_MODE | Moka::COLOR_MODE_8);
+	Wire.endTransmission();
+
+	return buildMap();
+}
+
+// Probe the 32 tile addresses (10 to 41) once, and record the ones that answer.
+// Bit n of getPresent() is set when a tile answered at address 10 + n.
+// The bus must have been started before. Returns the number of tiles found.
+uint8_t Mokas::scan(){
+	uint8_t found = 0;
+	_present = 0;
+	for(uint8_t i = 0; i < 32; i++){
+		Wire.beginTransmission(10 + i);
+		if(Wire.endTransmission() == 0){
+			_present |= ((uint32_t)1 << i);
+			++found;
+		}
+	}
+
+	return found;
+}
+
+// Learn the physical layout of the tiles, by asking the user to press one key per tile.
+// All tiles light up with /color/, then the user presses the top left key (as seen on the wall)
+// of each tile, from left to right and up to down. Each tile goes off once it has been given its place.
+// The corner pressed gives the tile rotation; pressing any other key keeps the tile upright.
+// A tile set as mirrored before stays mirrored, and its corners are read as such.
+// /timeout/ is the max time allowed between two presses, in milliseconds. 0 waits forever.
+// Led states and colors are saved before, and given back to each led of the board when done.
+// If there is not enough memory to save them (18 bytes per tile), all leds are left shut with /color/.
+// Returns true on timeout, in which case the previous tile order is kept, or if the lookup table can't be built.
+bool Mokas::learnLayout(uint8_t color, uint16_t timeout){
+	Moka *found[32];
+	uint8_t orientation[32];
+	// Colors of all leds, then their states, 8 per byte.
+	uint16_t size = (uint16_t)_nbBoards * 16;
+	uint8_t *saved = new uint8_t[sceneSize()];
+	if(saved){
+		for(uint16_t i = 0; i < size; i++){
+			saved[i] = getColor(i);
+			if(!(i & 0x07)) saved[size + (i >> 3)] = 0;
+			if(isLed(i)) saved[size + (i >> 3)] |= _BV(i & 0x07);
+		}
+	}
+
+	uint32_t left = 0;
+	for(uint8_t i = 0; i < _nbBoards; i++){
+		found[i] = _boards[i];
+		orientation[i] = _orientation[i];
+		left |= ((uint32_t)1 << i);
+		found[i]->setGlobalColor(color);
+		for(uint8_t j = 0; j < 16; j++){
+			found[i]->setLed(j);
+		}
+		found[i]->readButtons();
+	}
+	updateLeds();
+	updateDisplay();
+
+	bool timedOut = false;
+	uint32_t start = millis();
+	uint8_t slot = 0;
+	while(slot < _nbBoards){
+		if(timeout && ((millis() - start) > timeout)){
+			for(uint8_t i = 0; i < _nbBoards; i++){
+				_boards[i] = found[i];
+				_orientation[i] = orientation[i];
+			}
+			timedOut = true;
+			break;
+		}
+
+		for(uint8_t i = 0; i < _nbBoards; i++){
+			if(!(left & ((uint32_t)1 << i))) continue;
+			if(!found[i]->readButtons()) continue;
+			if(found[i]->getButtons() == 0) continue;
+
+			// Mirroring can't be seen from one key, so the tile keeps the one it had.
+			uint8_t mirror = orientation[i] & MIRROR;
+			_orientation[slot] = ROTATE_0 | mirror;
+			for(uint8_t o = ROTATE_90; o <= ROTATE_270; o++){
+				if(found[i]->getButtons() == _BV(orientIndex(0, 0, o | mirror))){
+					_orientation[slot] = o | mirror;
+				}
+			}
+			_boards[slot++] = found[i];
+			left &= ~((uint32_t)1 << i);
+			for(uint8_t j = 0; j < 16; j++){
+				found[i]->clrLed(j);
+			}
+			found[i]->updateLeds();
+			found[i]->updateDisplay();
+			start = millis();
+			break;
+		}
+	}
+
+	bool status = timedOut ? true : buildMap();
+
+	// Give the leds back with the new layout, or shut the ones still lit.
+	for(uint16_t i = 0; i < size; i++){
+		if(saved){
+			setColor(i, saved[i]);
+			if(saved[size + (i >> 3)] & _BV(i & 0x07)){
+				setLed(i);
+			} else {
+				clrLed(i);
+			}
+		} else {
+			clrLed(i);
+		}
+	}
+	delete[] saved;
+	updateLeds();
+	updateDisplay();
+
+	return status;
+}
+
+// Change the orientation of a tile already added, see ORIENTATION.
+void Mokas::setOrientation(uint8_t board, uint8_t orientation){
+	if(board >= _nbBoards) return;
+	_orientation[board] = orientation;
+	if(_map) buildMap();
+}
+
+// Playhead: a column of leds, shown with its own color over the board, that sweeps from left to right.
+// Each step only sends the leds of the outgoing and incoming columns, and the writes for the next step
+// are staged beforehand, so step timing doesn't depend on what else changed in the frame.
+// Start the playhead. /step/ is the step duration in microseconds for the internal clock,
+// or 0 to drive it from an external tick with tickPlayhead().
+// Calling it again while running restarts the playhead, e.g. to change tempo or color:
+// the current column is cleared first, so no tile keeps a stale overlay or color.
+void Mokas::beginPlayhead(uint8_t color, uint32_t step){
+	stopPlayhead();
+
+	for(uint8_t i = 0; i < _nbBoards; i++){
+		_boards[i]->_overlayColor = color;
+	}
+
+	_playing = true;
+	_playhead = _sizeX - 1;
+	_playNext = 0;
+	_playStep = step;
+	_nextStep = micros();
+
+	stagePlayhead();
+}
+
+// Move the playhead when the internal clock says so. This has to be called as often as possible.
+// Steps are kept in phase with the start: if a step is late by more than a step duration, the missed ones are dropped.
+// Returns true when the playhead has moved.
+bool Mokas::updatePlayhead(){
+	if(!_playing || _playStep == 0) return false;
+
+	uint32_t now = micros();
+	if((int32_t)(now - _nextStep) < 0) return false;
+
+	uint32_t due = _nextStep;
+	do{
+		_nextStep += _playStep;
+	} while((int32_t)(now - _nextStep) >= 0);
+
+	stepPlayhead(due);
+
+	return true;
+}
+
+// Move the playhead on an external tick, e.g. a clock message received by the sketch.
+void Mokas::tickPlayhead(){
+	if(!_playing) return;
+
+	stepPlayhead(micros());
+}
+
+// Stop the playhead and restore the leds it was covering.
+void Mokas::stopPlayhead(){
+	if(!_playing) return;
+
+	for(uint8_t i = 0; i < _nbBoards; i++){
+		_boards[i]->stageOverlay(0);
+		_boards[i]->commitOverlay();
+	}
+	updateDisplay();
+
+	_playing = false;
+}
+
+// Attach a MokaStats object to record step timing, in microseconds:
+// the time from when the step is due (clock or tick) to the display update that shows it.
+// This includes the bus time of a step, so the jitter is the spread of the values,
+// i.e. getMax() - getMin(), or the gap between low and high percentiles.
+void Mokas::setPlayheadStats(MokaStats *stats){
+	_playStats = stats;
+}
+
+// Stage the overlay of the tiles that hold the outgoing and incoming columns.
+void Mokas::stagePlayhead(){
+	_playBoards = 0;
+
+	uint8_t boardCol = _playhead / 4;
+	for(uint8_t row = 0; row < _nbRow; row++){
+		uint8_t board = boardCol + row * _nbCol;
+		_boards[board]->stageOverlay(0);
+		_playBoards |= ((uint32_t)1 << board);
+	}
+
+	boardCol = _playNext / 4;
+	uint8_t col = _playNext % 4;
+	for(uint8_t row = 0; row < _nbRow; row++){
+		uint8_t board = boardCol + row * _nbCol;
+		uint16_t mask = 0;
+		for(uint8_t i = 0; i < 4; i++){
+			mask |= _BV(orientIndex(col, i, _orientation[board]));
+		}
+		_boards[board]->stageOverlay(mask);
+		_playBoards |= ((uint32_t)1 << board);
+	}
+}
+
+// Send the staged step, then stage the next one.
+void Mokas::stepPlayhead(uint32_t due){
+	for(uint8_t i = 0; i < _nbBoards; i++){
+		if(_playBoards & ((uint32_t)1 << i)){
+			_boards[i]->commitOverlay();
+		}
+	}
+	updateDisplay();
+
+	if(_playStats) _playStats->add(micros() - due);
+
+	_playhead = _playNext;
+	if(++_playNext >= _sizeX) _playNext = 0;
+	stagePlayhead();
+}
+
+// Get the mask of the leds of a tile covered by a rectangle, as seen on the wall.
+// A rotated or mirrored rectangle is still a rectangle, so only its corners have to be converted.
+uint16_t Mokas::rectMask(uint8_t col0, uint8_t row0, uint8_t col1, uint8_t row1, uint8_t orientation){
+	uint8_t first = orientIndex(col0, row0, orientation);
+	uint8_t last = orientIndex(col1, row1, orientation);
+
+	uint8_t minCol = Moka::indexToCol(first);
+	uint8_t maxCol = Moka::indexToCol(last);
+	if(minCol > maxCol){
+		maxCol = minCol;
+		minCol = Moka::indexToCol(last);
+	}
+
+	uint8_t minRow = Moka::indexToRow(first);
+	uint8_t maxRow = Moka::indexToRow(last);
+	if(minRow > maxRow){
+		maxRow = minRow;
+		minRow = Moka::indexToRow(last);
+	}
+
+	uint16_t rowMask = (0x0F >> (3 - (maxCol - minCol))) << minCol;
+	uint16_t mask = 0;
+	for(uint8_t row = minRow; row <= maxRow; row++){
+		mask |= rowMask << (row * 4);
+	}
+
+	return mask;
+}
+
+// Build the lookup table that gives, for each global index, the tile and the local index on this tile.
+// It's done once at setup, so index conversion doesn't need any division,
+// and rotated tiles are as fast as upright ones.
+// The table is allocated on the heap: 2 bytes per led, 32 bytes per tile, 1KB for a 32 tiles wall.
+// Returns true if it couldn't be allocated.
+bool Mokas::buildMap(){
+	delete[] _map;
+	_map = new uint16_t[(uint16_t)_nbBoards * 16];
+	if(_map == NULL) return true;
+
+	uint16_t index = 0;
+	for(uint8_t row = 0; row < _sizeY; row++){
+		for(uint8_t col = 0; col < _sizeX; col++){
+			uint8_t board = (col / 4) + (row / 4) * _nbCol;
+			uint8_t button = orientIndex(col % 4, row % 4, _orientation[board]);
+			_map[index++] = ((uint16_t)board << 4) | button;
+		}
+	}
+
 	return false;
 }
+
+// Convert a position on a tile, as seen on the wall, to the index of the button on this tile.
+uint8_t Mokas::orientIndex(uint8_t col, uint8_t row, uint8_t orientation){
+	if(orientation & MIRROR) col = 3 - col;
+
+	uint8_t temp = col;
+	switch(orientation & 0x03){
+		case ROTATE_90:
+			col = row;
+			row = 3 - temp;
+			break;
+		case ROTATE_180:
+			col = 3 - col;
+			row = 3 - row;
+			break;
+		case ROTATE_270:
+			col = 3 - row;
+			row = temp;
+			break;
+		default:
+			break;
+	}
+
+	return Moka::posToIndex(col, row);
+}
+
 // All public methods works exactly the same for Mokas class ( one or several boards)
 // and Moka class (only one board). See first part of this file for information on how they work.
 // All these methods essentially call the one-tile method on each board that need it.
@@ -510,6 +1211,119 @@ void Mokas::updateDisplay() const{
 	Wire.beginTransmission(0);
 	Wire.write(Moka::UPDATE_DISPLAY);
 	Wire.endTransmission();
+
+	for(uint8_t i = 0; i < _nbBoards; i++){
+		_boards[i]->stamp();
+	}
+}
+
+
+// Region operations: they split the region per tile once, then apply one mask operation per tile,
+// so they run in time proportional to the number of tiles touched, not the number of leds.
+// See Moka::LED_OP for operations. Regions are clipped to the board size.
+
+// Apply an operation to a mask of leds on one tile.
+void Mokas::setLedMask(uint8_t board, uint16_t mask, uint8_t op, uint8_t value){
+	if(board >= _nbBoards) return;
+
+	_boards[board]->setLedMask(mask, op, value);
+}
+
+// Apply an operation to a rectangle of /width/ x /height/ leds, starting from /col/, /row/.
+void Mokas::fillRect(uint8_t col, uint8_t row, uint8_t width, uint8_t height, uint8_t op, uint8_t value){
+	if(col >= _sizeX || row >= _sizeY) return;
+	if(width == 0 || height == 0) return;
+
+	uint8_t endX = ((uint16_t)col + width > _sizeX) ? _sizeX : col + width;
+	uint8_t endY = ((uint16_t)row + height > _sizeY) ? _sizeY : row + height;
+
+	for(uint8_t boardRow = row / 4; boardRow <= (endY - 1) / 4; boardRow++){
+		uint8_t top = boardRow * 4;
+		uint8_t row0 = (row > top) ? row - top : 0;
+		uint8_t row1 = (endY < top + 4) ? endY - 1 - top : 3;
+
+		for(uint8_t boardCol = col / 4; boardCol <= (endX - 1) / 4; boardCol++){
+			uint8_t left = boardCol * 4;
+			uint8_t col0 = (col > left) ? col - left : 0;
+			uint8_t col1 = (endX < left + 4) ? endX - 1 - left : 3;
+
+			uint8_t board = boardCol + boardRow * _nbCol;
+			_boards[board]->setLedMask(rectMask(col0, row0, col1, row1, _orientation[board]), op, value);
+		}
+	}
+}
+
+// Apply an operation to /length/ leds of a row, starting from col /start/. Default is the whole row.
+void Mokas::setRow(uint8_t row, uint8_t op, uint8_t value, uint8_t start, uint8_t length){
+	fillRect(start, row, length, 1, op, value);
+}
+
+// Apply an operation to /length/ leds of a column, starting from row /start/. Default is the whole column.
+void Mokas::setCol(uint8_t col, uint8_t op, uint8_t value, uint8_t start, uint8_t length){
+	fillRect(col, start, 1, length, op, value);
+}
+
+// Copy state and color of a rectangle of leds to another place. Source and destination can overlap.
+// Contrarly to other region operations, this one goes led by led, as source and destination
+// don't need to be aligned the same way on tiles. It still uses the lookup table when there is one, without any division.
+void Mokas::copyRect(uint8_t srcCol, uint8_t srcRow, uint8_t width, uint8_t height, uint8_t dstCol, uint8_t dstRow){
+	if(srcCol >= _sizeX || srcRow >= _sizeY) return;
+	if(dstCol >= _sizeX || dstRow >= _sizeY) return;
+
+	uint8_t maxCol = (srcCol > dstCol) ? srcCol : dstCol;
+	uint8_t maxRow = (srcRow > dstRow) ? srcRow : dstRow;
+	if((uint16_t)maxCol + width > _sizeX) width = _sizeX - maxCol;
+	if((uint16_t)maxRow + height > _sizeY) height = _sizeY - maxRow;
+	if(width == 0 || height == 0) return;
+
+	// Go backward when the destination is after the source, so overlapping leds are read before being written.
+	bool backX = dstCol > srcCol;
+	bool backY = dstRow > srcRow;
+
+	for(uint8_t j = 0; j < height; j++){
+		uint8_t y = backY ? height - 1 - j : j;
+		uint16_t src = posToIndex(srcCol, srcRow + y);
+		uint16_t dst = posToIndex(dstCol, dstRow + y);
+
+		for(uint8_t i = 0; i < width; i++){
+			uint8_t x = backX ? width - 1 - i : i;
+			Moka *from = _boards[indexToBoard(src + x)];
+			Moka *to = _boards[indexToBoard(dst + x)];
+			uint8_t fromButton = indexToBoardButton(src + x);
+			uint8_t toButton = indexToBoardButton(dst + x);
+
+			to->setColor(toButton, from->getColor(fromButton));
+			if(from->isLed(fromButton)){
+				to->setLed(toButton);
+			} else {
+				to->clrLed(toButton);
+			}
+		}
+	}
+}
+
+// Scenes for the whole board are the scenes of each tile, one after the other.
+// Get the number of bytes needed to store a scene for this board.
+uint16_t Mokas::sceneSize() const{
+	return (uint16_t)_nbBoards * Moka::SCENE_SIZE;
+}
+
+void Mokas::saveScene(uint8_t *scene) const{
+	for(uint8_t i = 0; i < _nbBoards; i++){
+		_boards[i]->saveScene(scene + (uint16_t)i * Moka::SCENE_SIZE);
+	}
+}
+
+void Mokas::recallScene(const uint8_t *scene){
+	for(uint8_t i = 0; i < _nbBoards; i++){
+		_boards[i]->recallScene(scene + (uint16_t)i * Moka::SCENE_SIZE);
+	}
+}
+
+void Mokas::recallScene_P(const uint8_t *scene){
+	for(uint8_t i = 0; i < _nbBoards; i++){
+		_boards[i]->recallScene_P(scene + (uint16_t)i * Moka::SCENE_SIZE);
+	}
 }
 
 
@@ -522,36 +1336,56 @@ bool Mokas::readButtons(){
 	return newRead;
 }
 
+void Mokas::setReactive(uint8_t mode){
+	for(uint8_t i = 0; i < _nbBoards; i++){
+		_boards[i]->setReactive(mode);
+	}
+}
+
+// Lazy reads are set for each tile, so a query only reads the tile that owns the button.
+void Mokas::setMaxAge(uint16_t age){
+	for(uint8_t i = 0; i < _nbBoards; i++){
+		_boards[i]->setMaxAge(age);
+	}
+}
 
-bool Mokas::isPressed(uint16_t index) const{
+// All tiles share the same MokaStats object, so latency is reported for the whole board.
+void Mokas::setStats(MokaStats *stats){
+	for(uint8_t i = 0; i < _nbBoards; i++){
+		_boards[i]->setStats(stats);
+	}
+}
+
+
+bool Mokas::isPressed(uint16_t index){
 	return _boards[indexToBoard(index)]->isPressed(indexToBoardButton(index));
 }
 
-bool Mokas::isPressed(uint8_t col, uint8_t row) const{
+bool Mokas::isPressed(uint8_t col, uint8_t row){
 	return isPressed(posToIndex(col, row));
 }
 
-bool Mokas::wasPressed(uint16_t index) const{
+bool Mokas::wasPressed(uint16_t index){
 	return _boards[indexToBoard(index)]->wasPressed(indexToBoardButton(index));
 }
 
-bool Mokas::wasPressed(uint8_t col, uint8_t row) const{
+bool Mokas::wasPressed(uint8_t col, uint8_t row){
 	return wasPressed(posToIndex(col, row));
 }
 
-bool Mokas::isJustPressed(uint16_t index) const{
+bool Mokas::isJustPressed(uint16_t index){
 	return _boards[indexToBoard(index)]->isJustPressed(indexToBoardButton(index));
 }
 
-bool Mokas::isJustPressed(uint8_t col, uint8_t row) const{
+bool Mokas::isJustPressed(uint8_t col, uint8_t row){
 	return isJustPressed(posToIndex(col, row));
 }
 
-bool Mokas::isJustReleased(uint16_t index) const{
+bool Mokas::isJustReleased(uint16_t index){
 	return _boards[indexToBoard(index)]->isJustReleased(indexToBoardButton(index));
 }
 
-bool Mokas::isJustReleased(uint8_t col, uint8_t row) const{
+bool Mokas::isJustReleased(uint8_t col, uint8_t row){
 	return isJustReleased(posToIndex(col, row));
 }
 
@@ -621,23 +1455,31 @@ uint8_t Mokas::indexToBoardRow(uint16_t index) const{
 
 // Convert an index to a board index (i.e. the boad number, running from 0 at top left to N at bottom right).
 // e.g. index 33 on a 2x2 board (8x8 buttons) will give 2, as it's the second button on the #2 (third) tile.
+// This and the following ones use the lookup table built at setup.
+// Until it's built (or if it couldn't be), they compute the same values, only slower.
 uint8_t Mokas::indexToBoard(uint16_t index) const{
-	return (indexToBoardCol(index) + indexToBoardRow(index) * _nbCol);
+	if(_map == NULL) return (indexToBoardCol(index) + indexToBoardRow(index) * _nbCol);
+
+	return (_map[index] >> 4);
 }
 
-// Convert a global index to local index on the appropriate tile.
-// e.g. index 8 on a 2x2 board (8x8 buttons) will give 4 (that is the corresponding index on board #1).
+// Convert a global index to local index on the appropriate tile, taking the tile orientation into account.
+// e.g. index 8 on a 2x2 board (8x8 buttons) of upright tiles will give 4 (that is the corresponding index on board #1).
 uint8_t Mokas::indexToBoardButton(uint16_t index) const{
-	return (Moka::posToIndex(indexToBoardButtonCol(index), indexToBoardButtonRow(index)));
+	if(_map == NULL){
+		return orientIndex(indexToCol(index) % 4, indexToRow(index) % 4, _orientation[indexToBoard(index)]);
+	}
+
+	return (_map[index] & 0x0F);
 }
 
 // Convert a global index to local column number on the appropriate tile.
-// e.g. index 13 on a 2x2 board (8x8 buttons) will give 1 (that is the correspondig column on board #2).
+// e.g. index 13 on a 2x2 board (8x8 buttons) of upright tiles will give 1 (that is the correspondig column on board #2).
 uint8_t Mokas::indexToBoardButtonCol(uint16_t index) const{
-	return (indexToCol(index) - 4 * indexToBoardCol(index));
+	return Moka::indexToCol(indexToBoardButton(index));
 }
 
 // Convert a global index to local row number on the appropriate tile.
 uint8_t Mokas::indexToBoardButtonRow(uint16_t index) const{
-	return (indexToRow(index) - 4 * indexToBoardRow(index));
+	return Moka::indexToRow(indexToBoardButton(index));
 }
@@ -34,6 +34,29 @@
 
 #include <Wire.h>
 
+// Small histogram used to report timings, e.g. press to light latency.
+// Values are stored in 32 buckets of /width/ each, the last one holding everything above.
+// Percentiles are thus given with a precision of one bucket width.
+class MokaStats{
+public:
+    MokaStats(uint16_t width = 500);
+
+    void add(uint32_t value);
+    void reset();
+
+    uint32_t percentile(uint8_t percent) const;
+
+    inline uint16_t getCount() const {return _count;}
+    inline uint32_t getMin() const {return _min;}
+    inline uint32_t getMax() const {return _max;}
+
+private:
+    uint16_t _bucket[32];
+    uint16_t _width;
+    uint16_t _count;
+    uint32_t _min, _max;
+};
+
 class Moka{
 public:
 
@@ -66,8 +89,26 @@ public:
 		I2C_400 = 1,
 	};
 
+	enum REACTIVE_MODE{
+		REACTIVE_OFF = 0,					// Leds only change when the sketch says so
+		REACTIVE_MOMENTARY,					// Led is lit while its key is pressed
+		REACTIVE_TOGGLE,					// Led toggles each time its key is pressed
+	};
+
+	enum LED_OP{
+		OP_STATE = 0,						// value 0 shuts leds, anything else lits them
+		OP_COLOR,							// value is the whole color, 0bAARRGGBB
+		OP_RGB,								// value is the color, brightness of each led is kept
+		OP_BRIGHTNESS,						// value is the brightness, 0 to 3
+	};
+
+	enum SCENE{
+		SCENE_SIZE = 18,					// Led state (2 bytes, MSB first) + 16 colors
+	};
+
     void begin(uint8_t address, bool fast = false);
     void beginFast(uint8_t address);
+    void attach(uint8_t address);
 
     void setLed(uint8_t index);
     void setLed(uint8_t col, uint8_t row);
@@ -87,20 +128,29 @@ public:
     uint8_t getBrightness(uint8_t col, uint8_t row) const;
 
     void setGlobalColor(uint8_t color);
+    void setLedMask(uint16_t mask, uint8_t op, uint8_t value);
 
     void updateLeds();
     void updateDisplay() const;
 
+    void saveScene(uint8_t *scene) const;
+    void recallScene(const uint8_t *scene);
+    void recallScene_P(const uint8_t *scene);
+
     bool readButtons();
 
-    bool isPressed(uint8_t index) const;
-    bool isPressed(uint8_t col, uint8_t row) const;
-    bool wasPressed(uint8_t index) const;
-    bool wasPressed(uint8_t col, uint8_t row) const;
-    bool isJustPressed(uint8_t index) const;
-    bool isJustPressed(uint8_t col, uint8_t row) const;
-    bool isJustReleased(uint8_t index) const;
-    bool isJustReleased(uint8_t col, uint8_t row) const;
+    void setReactive(uint8_t mode);
+    void setStats(MokaStats *stats);
+    void setMaxAge(uint16_t age);
+
+    bool isPressed(uint8_t index);
+    bool isPressed(uint8_t col, uint8_t row);
+    bool wasPressed(uint8_t index);
+    bool wasPressed(uint8_t col, uint8_t row);
+    bool isJustPressed(uint8_t index);
+    bool isJustPressed(uint8_t col, uint8_t row);
+    bool isJustReleased(uint8_t index);
+    bool isJustReleased(uint8_t col, uint8_t row);
 
     void displayOn();
     void displayOff();
@@ -114,6 +164,8 @@ public:
 
     inline uint8_t getSizeX() const {return _sizeX;}
     inline uint8_t getSizeY() const {return _sizeY;}
+    inline uint8_t getAddress() const {return _i2cAddress;}
+    inline uint16_t getButtons() const {return _buttons;}
 
     // These functions can be called when needed to convert a pos to index, or index to pos.
     // They are static so you don't need to use them on an instance of the class.
@@ -129,20 +181,74 @@ protected:
 
     uint16_t _ledState;
 
-    uint16_t _buttons, _prevButtons;
+    uint16_t _buttons;
+    uint16_t _prevButtons;
 
 private:
+    friend class Mokas;
+
+    void react(uint16_t pressed, uint16_t released);
+    void stamp() const;
+    void applyScene(const uint8_t *scene);
+    void refresh();
+    void consume(uint8_t index);
+
+    void stageOverlay(uint16_t mask);
+    bool commitOverlay();
+    inline uint8_t ledColor(uint8_t index) const {return (_overlay & _BV(index)) ? _overlayColor : _led[index];}
+    inline uint16_t ledState() const {return _ledState | _overlay;}
+
     uint8_t _i2cAddress;
     uint16_t _update;
+    bool _updateState;
+
+    uint8_t _reactive;
+    MokaStats *_stats;
+    mutable uint16_t _pressPending;
+    uint32_t *_pressTime;
+
+    uint16_t _maxAge;
+    uint32_t _lastRead;
+    uint16_t _queried;
+
+    uint16_t _overlay, _nextOverlay;
+    uint8_t _overlayColor;
 
 };
 
 class Mokas{
 public:
 
+	// Orientation of a tile on the wall, i.e. how it has been turned clockwise from upright.
+	// MIRROR can be or'ed with a rotation, for tiles seen left to right reversed.
+	enum ORIENTATION{
+		ROTATE_0 = 0,
+		ROTATE_90 = 1,
+		ROTATE_180 = 2,
+		ROTATE_270 = 3,
+		MIRROR = 4,
+	};
+
+    Mokas();
+
     bool begin(uint8_t cols, uint8_t rows);
-    bool add(Moka *board);
+    bool add(Moka *board, uint8_t orientation = ROTATE_0);
     bool beginAuto(uint8_t cols, uint8_t rows, bool fast = false);
+    bool beginScan(uint8_t cols, uint8_t rows, bool fast = false);
+
+    uint8_t scan();
+    bool learnLayout(uint8_t color = 0xFF, uint16_t timeout = 0);
+    inline uint32_t getPresent() const {return _present;}
+
+    void setOrientation(uint8_t board, uint8_t orientation);
+    inline uint8_t getOrientation(uint8_t board) const {return _orientation[board];}
+
+    void beginPlayhead(uint8_t color, uint32_t step = 0);
+    bool updatePlayhead();
+    void tickPlayhead();
+    void stopPlayhead();
+    void setPlayheadStats(MokaStats *stats);
+    inline uint8_t getPlayhead() const {return _playhead;}
 
     void setLed(uint16_t index);
     void setLed(uint8_t col, uint8_t row);
@@ -163,19 +269,34 @@ public:
 
     void setGlobalColor(uint8_t color);
 
+    void setLedMask(uint8_t board, uint16_t mask, uint8_t op, uint8_t value);
+    void fillRect(uint8_t col, uint8_t row, uint8_t width, uint8_t height, uint8_t op, uint8_t value);
+    void setRow(uint8_t row, uint8_t op, uint8_t value, uint8_t start = 0, uint8_t length = 0xFF);
+    void setCol(uint8_t col, uint8_t op, uint8_t value, uint8_t start = 0, uint8_t length = 0xFF);
+    void copyRect(uint8_t srcCol, uint8_t srcRow, uint8_t width, uint8_t height, uint8_t dstCol, uint8_t dstRow);
+
     void updateLeds();
     void updateDisplay() const;
 
+    uint16_t sceneSize() const;
+    void saveScene(uint8_t *scene) const;
+    void recallScene(const uint8_t *scene);
+    void recallScene_P(const uint8_t *scene);
+
     bool readButtons();
 
-    bool isPressed(uint16_t index) const;
-    bool isPressed(uint8_t col, uint8_t row) const;
-    bool wasPressed(uint16_t index) const;
-    bool wasPressed(uint8_t col, uint8_t row) const;
-    bool isJustPressed(uint16_t index) const;
-    bool isJustPressed(uint8_t col, uint8_t row) const;
-    bool isJustReleased(uint16_t index) const;
-    bool isJustReleased(uint8_t col, uint8_t row) const;
+    void setReactive(uint8_t mode);
+    void setStats(MokaStats *stats);
+    void setMaxAge(uint16_t age);
+
+    bool isPressed(uint16_t index);
+    bool isPressed(uint8_t col, uint8_t row);
+    bool wasPressed(uint16_t index);
+    bool wasPressed(uint8_t col, uint8_t row);
+    bool isJustPressed(uint16_t index);
+    bool isJustPressed(uint8_t col, uint8_t row);
+    bool isJustReleased(uint16_t index);
+    bool isJustReleased(uint8_t col, uint8_t row);
 
     void displayOn();
     void displayOff();
@@ -202,13 +323,32 @@ public:
 	uint8_t indexToBoardButtonRow(uint16_t index) const;
 
 private:
+	bool buildMap();
+	static uint8_t orientIndex(uint8_t col, uint8_t row, uint8_t orientation);
+	static uint16_t rectMask(uint8_t col0, uint8_t row0, uint8_t col1, uint8_t row1, uint8_t orientation);
+
+	void stagePlayhead();
+	void stepPlayhead(uint32_t due);
+
 	Moka *_boards[32];
+	uint8_t _orientation[32];
+
+	// Global index to tile and local index lookup table: (tile << 4) | local index.
+	uint16_t *_map;
 
     uint8_t _sizeX;
     uint8_t _sizeY;
 
 	uint8_t _nbBoards, _nbCol, _nbRow;
 	uint8_t _addBoard;
+
+	uint32_t _present;
+
+	bool _playing;
+	uint8_t _playhead, _playNext;
+	uint32_t _playStep, _nextStep;
+	uint32_t _playBoards;
+	MokaStats *_playStats;
 };
 
 #endif
\ No newline at end of file
@@ -234,170 +234,56 @@ void ledOne(OSCMessage &msg, int offset){
 	}
 }
 
-void ledRow(OSCMessage &msg, int offset){
-	uint8_t maxSize = board.getSizeX();
-
+uint8_t ledOp(){
+	if(nowSetting == SET_INT){
+		return Moka::OP_BRIGHTNESS;
+	} else if(nowSetting == SET_RGB){
+		return Moka::OP_RGB;
+	} else {
+		return Moka::OP_STATE;
+	}
+}
 
+void ledRow(OSCMessage &msg, int offset){
 	uint8_t size = msg.size();
 
-	uint8_t index, start, length, end = 0;
-	uint8_t state = 0;
-
-	state = (uint8_t)msg.getInt(0);
-	index = (uint8_t)msg.getInt(1);
+	uint8_t state = (uint8_t)msg.getInt(0);
+	uint8_t index = (uint8_t)msg.getInt(1);
 
 	if(size == 4){
-		start = (uint8_t)msg.getInt(2);
-		length = (uint8_t)msg.getInt(3);
-		end = start + length;
-		if(end > maxSize) end = maxSize;
+		board.setRow(index, ledOp(), state, (uint8_t)msg.getInt(2), (uint8_t)msg.getInt(3));
 	} else {
-		start = 0;
-		end = maxSize;
-	}
-
-	if(nowSetting == SET_STATE){
-		for(uint8_t i = start; i < end; ++i){
-			if(state == 0){
-				board.clrLed(i, index);
-			} else {
-				board.setLed(i, index);
-			}
-		}
-	} else if(nowSetting == SET_INT){
-		for(uint8_t i = start; i < end; ++i){
-			board.setBrightness(i, index, state);
-		}
-
-	} else if(nowSetting == SET_RGB){
-		for(uint8_t i = start; i < end; ++i){
-			state &= 0b00111111;
-			state |= (board.getBrightness(i, index) << 6);
-			board.setColor(i, index, state);
-		}
+		board.setRow(index, ledOp(), state);
 	}
 }
 
 void ledCol(OSCMessage &msg, int offset){
-	uint8_t maxSize = board.getSizeY();
-
-
 	uint8_t size = msg.size();
 
-	uint8_t index, start, length, end = 0;
-	uint8_t state = 0;
-
-	state = (uint8_t)msg.getInt(0);
-	index = (uint8_t)msg.getInt(1);
+	uint8_t state = (uint8_t)msg.getInt(0);
+	uint8_t index = (uint8_t)msg.getInt(1);
 
 	if(size == 4){
-		start = (uint8_t)msg.getInt(2);
-		length = (uint8_t)msg.getInt(3);
-		end = start + length;
-		if(end > maxSize) end = maxSize;
+		board.setCol(index, ledOp(), state, (uint8_t)msg.getInt(2), (uint8_t)msg.getInt(3));
 	} else {
-		start = 0;
-		end = maxSize;
-	}
-
-	if(nowSetting == SET_STATE){
-		for(uint8_t i = start; i < end; ++i){
-			if(state == 0){
-				board.clrLed(index, i);
-			} else {
-				board.setLed(index, i);
-			}
-		}
-	} else if(nowSetting == SET_INT){
-		for(uint8_t i = start; i < end; ++i){
-			board.setBrightness(index, i, state);
-		}
-
-	} else if(nowSetting == SET_RGB){
-		for(uint8_t i = start; i < end; ++i){
-			state &= 0b00111111;
-			state |= (board.getBrightness(index, i) << 6);
-			board.setColor(index, i, state);
-		}
+		board.setCol(index, ledOp(), state);
 	}
 }
 
 void ledMap(OSCMessage &msg, int offset){
-	uint8_t maxSizeX = board.getSizeX();
-	uint8_t maxSizeY = board.getSizeY();
-
-
-	uint8_t size = msg.size();
-
-	uint8_t index, startX, startY, lengthX, lengthY, endX, endY = 0;
-	uint8_t state = 0;
-
-	state = (uint8_t)msg.getInt(0);
-	startX = (uint8_t)msg.getInt(1);
-	startY = (uint8_t)msg.getInt(2);
-	lengthX = (uint8_t)msg.getInt(3);
-	lengthY = (uint8_t)msg.getInt(4);
-
-	endX = startX + lengthX;
-	if(endX > maxSizeX) endX = maxSizeX;
-
-	endY = startY + lengthY;
-	if(endY > maxSizeY) endY = maxSizeY;
+	uint8_t state = (uint8_t)msg.getInt(0);
+	uint8_t startX = (uint8_t)msg.getInt(1);
+	uint8_t startY = (uint8_t)msg.getInt(2);
+	uint8_t lengthX = (uint8_t)msg.getInt(3);
+	uint8_t lengthY = (uint8_t)msg.getInt(4);
 
-	if(nowSetting == SET_STATE){
-		for(uint8_t x = startX; x < endX; ++x){
-			for(uint8_t y = startY; y < endY; ++y){
-				if(state == 0){
-					board.clrLed(x, y);
-				} else {
-					board.setLed(x, y);
-				}
-			}
-		}
-	} else if(nowSetting == SET_INT){
-		for(uint8_t x = startX; x < endX; ++x){
-			for(uint8_t y = startY; y < endY; ++y){
-				board.setBrightness(x, y, state);
-			}
-		}
-
-	} else if(nowSetting == SET_RGB){
-		for(uint8_t x = startX; x < endX; ++x){
-			for(uint8_t y = startY; y < endY; ++y){
-				state &= 0b00111111;
-				state |= (board.getBrightness(x, y) << 6);
-				board.setColor(x, y, state);
-			}
-		}
-	}
+	board.fillRect(startX, startY, lengthX, lengthY, ledOp(), state);
 }
 
 void ledAll(OSCMessage &msg, int offset){
-	uint16_t boardSize = board.getSizeX() * board.getSizeY();
-
-	uint8_t state;
+	uint8_t state = (uint8_t)msg.getInt(0);
 
-	state = (uint8_t)msg.getInt(0);
-
-	if(nowSetting == SET_STATE){
-		for(uint16_t i = 0; i < boardSize; ++i){
-			if(state == 0){
-				board.clrLed(i);
-			} else {
-				board.setLed(i);
-			}
-		}
-	} else if(nowSetting == SET_INT){
-		for(uint16_t i = 0; i < boardSize; ++i){
-			board.setBrightness(i, state);
-		}
-	} else if(nowSetting == SET_RGB){
-		state &= 0b00111111;
-		state |= (board.getBrightness(0) << 6);
-		for(uint16_t i = 0; i < boardSize; ++i){
-			board.setColor(i, state);
-		}
-	}
+	board.fillRect(0, 0, board.getSizeX(), board.getSizeY(), ledOp(), state);
 }
 
 
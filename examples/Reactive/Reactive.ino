@@ -0,0 +1,37 @@
+
+#include "Moka.h"
+
+Mokas board;
+
+MokaStats latency(250);
+
+uint8_t color = 0b00110100;
+
+void setup(){
+	Serial.begin(115200);
+
+	board.beginAuto(2, 2);
+	board.setGlobalColor(color);
+
+	// Leds light as soon as their key is read pressed, and latency is recorded.
+	board.setReactive(Moka::REACTIVE_MOMENTARY);
+	board.setStats(&latency);
+}
+
+void loop(){
+	board.readButtons();
+
+	board.updateLeds();
+	board.updateDisplay();
+
+	if(latency.getCount() >= 100){
+		Serial.print("latency (us) p50: ");
+		Serial.print(latency.percentile(50));
+		Serial.print("\tp95: ");
+		Serial.print(latency.percentile(95));
+		Serial.print("\tmax: ");
+		Serial.println(latency.getMax());
+		latency.reset();
+	}
+
+}
@@ -0,0 +1,38 @@
+
+#include "Moka.h"
+
+Mokas board;
+
+uint8_t color = 0b00110100;
+
+void setup(){
+	Serial.begin(115200);
+
+	// Scan the bus, and set all tiles found at once.
+	if(board.beginScan(2, 2)){
+		Serial.print("tiles found: ");
+		Serial.println(board.getPresent(), BIN);
+		while(1);
+	}
+
+	// Press one key on each tile, from left to right and up to down.
+	board.learnLayout(color);
+
+	board.setGlobalColor(color);
+}
+
+void loop(){
+	board.readButtons();
+	for(uint8_t i = 0; i < 64; ++i){
+		if(board.isJustPressed(i)){
+			board.setLed(i);
+		} else if(board.isJustReleased(i)){
+			board.clrLed(i);
+		}
+	}
+
+	board.updateLeds();
+	board.updateDisplay();
+	delay(10);
+
+}
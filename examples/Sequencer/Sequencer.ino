@@ -0,0 +1,59 @@
+
+#include "Moka.h"
+
+Mokas board;
+
+// Steps are late by the bus time of a step, a few milliseconds at 100KHz: 32 buckets of 500us cover 16ms.
+MokaStats steps(500);
+
+uint8_t color = 0b00110100;
+uint8_t playColor = 0b11001100;
+
+void setup(){
+	Serial.begin(115200);
+
+	board.beginAuto(2, 2);
+	board.setGlobalColor(color);
+	board.updateLeds();
+
+	// 120 BPM, 4 steps per beat.
+	board.setPlayheadStats(&steps);
+	board.beginPlayhead(playColor, 125000L);
+}
+
+void loop(){
+	if(board.updatePlayhead()){
+		uint8_t col = board.getPlayhead();
+		for(uint8_t row = 0; row < board.getSizeY(); ++row){
+			if(board.isLed(col, row)){
+				// Play the note for this row.
+			}
+		}
+	}
+
+	if(board.readButtons()){
+		for(uint16_t i = 0; i < 64; ++i){
+			if(board.isJustPressed(i)){
+				if(board.isLed(i)){
+					board.clrLed(i);
+				} else {
+					board.setLed(i);
+				}
+			}
+		}
+		board.updateLeds();
+		board.updateDisplay();
+	}
+
+	if(steps.getCount() >= 64){
+		// Lateness is mostly the constant bus time of a step; jitter is how much it varies.
+		Serial.print("step lateness (us) min: ");
+		Serial.print(steps.getMin());
+		Serial.print("\tmax: ");
+		Serial.print(steps.getMax());
+		Serial.print("\tjitter: ");
+		Serial.println(steps.getMax() - steps.getMin());
+		steps.reset();
+	}
+
+}